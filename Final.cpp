@@ -10,10 +10,21 @@
 #include <algorithm>
 #include <cmath>
 #include <iomanip>
+#include <ctime>
+#include <unordered_set>
+#include <tuple>
+#include <memory>
+#include <functional>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #ifdef _WIN32
 #include <windows.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <csignal>
+#include <sys/wait.h>
 #endif
 
 using namespace std;
@@ -27,9 +38,192 @@ public:
     Node(const string& name, double lat = 0, double lon = 0) : name(name), lat(lat), lon(lon) {}
 };
 
+class FareEngine {
+public:
+    // Surge is applied per hour of day, so there is one rule row per hour
+    static const int kTimeBands = 24;
+
+    // Rates for one time band with surge already applied; perHour is the per-minute rate * 60
+    struct RuleRow {
+        double baseFare;
+        double perKm;
+        double perHour;
+    };
+
+    // Struct-of-arrays batch of itineraries; fare is filled in by quoteBatch.
+    // A row with boarding = 1 carries the base fare of the rider who starts there.
+    struct FareBatch {
+        vector<double> distance;
+        vector<double> time;
+        vector<int> riders;
+        vector<int> boarding;
+        vector<int> band;
+        vector<double> fare;
+
+        void add(double d, double t, int r, int boards, int b = 0) {
+            distance.push_back(d);
+            time.push_back(t);
+            riders.push_back(r);
+            boarding.push_back(boards);
+            band.push_back(b);
+        }
+        size_t size() const { return distance.size(); }
+    };
+
+    FareEngine() { setDefaults(); }
+
+    void setDefaults() {
+        baseFare = 0.0;
+        perKm = 10.0;
+        perMin = 0.0;
+        shareDiscount = 0.3;
+        surgeByBand.assign(kTimeBands, 1.0);
+        compileRules();
+    }
+
+    // Config lines: "base 0", "per_km 10", "per_min 0", "surge <hour 0-23> <multiplier>", "share_discount 0.3"
+    void loadRulesFromFile(const string& filePath) {
+        setDefaults();
+
+        ifstream file(filePath);
+        if (!file) {
+            cerr << "Pricing file not found, using default fares." << endl;
+            return;
+        }
+
+        string line;
+        while (getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.find_first_not_of(" \t\n\v\f\r") == string::npos || line[0] == '#') {
+                continue;
+            }
+
+            stringstream ss(line);
+            string key;
+            ss >> key;
+
+            if (key == "surge") {
+                int band;
+                double multiplier;
+                if (!(ss >> band >> multiplier)) {
+                    cerr << "Ignoring malformed surge rule: " << line << endl;
+                    continue;
+                }
+                if (band < 0 || band >= kTimeBands) {
+                    cerr << "Ignoring surge rule for hour " << band << " (expected 0-23)." << endl;
+                    continue;
+                }
+                if (multiplier < 0.0) {
+                    cerr << "Ignoring negative surge multiplier for hour " << band << "." << endl;
+                    continue;
+                }
+                surgeByBand[band] = multiplier;
+                continue;
+            }
+
+            double* target = nullptr;
+            if (key == "base") target = &baseFare;
+            else if (key == "per_km") target = &perKm;
+            else if (key == "per_min") target = &perMin;
+            else if (key == "share_discount") target = &shareDiscount;
+            if (!target) {
+                cerr << "Ignoring unknown pricing rule: " << key << endl;
+                continue;
+            }
+
+            double value;
+            if (!(ss >> value)) {
+                cerr << "Ignoring malformed value for " << key << ": " << line << endl;
+                continue;
+            }
+            if (value < 0.0 || (target == &shareDiscount && value > 1.0)) {
+                cerr << "Ignoring out-of-range value for " << key << ": " << value << endl;
+                continue;
+            }
+            *target = value;
+        }
+        file.close();
+        compileRules();
+    }
+
+    // Quote every itinerary in the batch:
+    //   fare = boarding * base + (perKm * distance + perHour * time) / riders
+    // Two quotes are priced per SSE2 step; the scalar loop handles the tail
+    // and builds without SSE2.
+    void quoteBatch(FareBatch& batch) const {
+        size_t n = batch.size();
+        batch.fare.resize(n);
+
+        const double* __restrict d = batch.distance.data();
+        const double* __restrict t = batch.time.data();
+        const int* __restrict r = batch.riders.data();
+        const int* __restrict boards = batch.boarding.data();
+        const int* __restrict band = batch.band.data();
+        double* __restrict out = batch.fare.data();
+        const RuleRow* rows = rules.data();
+
+        size_t i = 0;
+#ifdef __SSE2__
+        const __m128d one = _mm_set1_pd(1.0);
+        for (; i + 2 <= n; i += 2) {
+            const RuleRow& row0 = rows[bandIndex(band[i])];
+            const RuleRow& row1 = rows[bandIndex(band[i + 1])];
+            __m128d base = _mm_set_pd(row1.baseFare, row0.baseFare);
+            __m128d km = _mm_set_pd(row1.perKm, row0.perKm);
+            __m128d hour = _mm_set_pd(row1.perHour, row0.perHour);
+
+            __m128d riders = _mm_max_pd(_mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*)(r + i))), one);
+            __m128d boarding = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*)(boards + i)));
+            __m128d metered = _mm_add_pd(_mm_mul_pd(km, _mm_loadu_pd(d + i)),
+                                         _mm_mul_pd(hour, _mm_loadu_pd(t + i)));
+            _mm_storeu_pd(out + i, _mm_add_pd(_mm_mul_pd(boarding, base), _mm_div_pd(metered, riders)));
+        }
+#endif
+        for (; i < n; ++i) {
+            const RuleRow& row = rows[bandIndex(band[i])];
+            double riders = r[i] > 1 ? r[i] : 1;
+            out[i] = boards[i] * row.baseFare + (row.perKm * d[i] + row.perHour * t[i]) / riders;
+        }
+    }
+
+    // Single solo trip; an empty trip costs nothing
+    double quote(double distance, double time, int band = 0) const {
+        FareBatch batch;
+        batch.add(distance, time, 1, distance > 0.0 ? 1 : 0, band);
+        quoteBatch(batch);
+        return batch.fare[0];
+    }
+
+    double applyShareDiscount(double price) const {
+        return price - price * shareDiscount;
+    }
+
+private:
+    double baseFare;
+    double perKm;
+    double perMin;
+    double shareDiscount;
+    vector<double> surgeByBand;
+    vector<RuleRow> rules;
+
+    void compileRules() {
+        rules.clear();
+        for (double surge : surgeByBand) {
+            rules.push_back({baseFare * surge, perKm * surge, perMin * 60.0 * surge});
+        }
+    }
+
+    static size_t bandIndex(int band) {
+        return static_cast<unsigned>(band) < static_cast<unsigned>(kTimeBands) ? band : 0;
+    }
+};
+
 class Graph {
 public:
     unordered_map<string, Node*> nodes;
+    FareEngine fares;
 
     struct RideMetrics {
         double distance;
@@ -37,7 +231,27 @@ public:
         double price;
     };
 
-    // Calculate metrics for a specific path segment
+    struct Route {
+        vector<string> path;
+        double distance;
+    };
+
+    // When set, rides are routed through this (e.g. the shard coordinator) instead of the local graph
+    function<Route(const string&, const string&)> routeFinder;
+
+    Route findRoute(const string& start, const string& end) const {
+        if (routeFinder) {
+            return routeFinder(start, end);
+        }
+        vector<string> path = aStarShortestPath(start, end);
+        return {path, calculateSegmentMetrics(path).distance};
+    }
+
+    RideMetrics calculateRouteMetrics(const Route& route) const {
+        return {route.distance, route.distance / 50.0, 0.0};
+    }
+
+    // Calculate distance and time for a specific path segment; pricing is done by the fare engine
     RideMetrics calculateSegmentMetrics(const vector<string>& path) const {
     RideMetrics metrics;
     
@@ -49,7 +263,7 @@ public:
     }
     
     metrics.time = metrics.distance / 50.0;
-    metrics.price = metrics.distance * 10.0;
+    metrics.price = 0.0;
 
     return metrics;
 }
@@ -196,51 +410,1358 @@ public:
     }
 
     // Calculate metrics for individual rides
-    RideMetrics calculateIndividualRideMetrics(const string& start, const string& end) {
-        vector<string> path = aStarShortestPath(start, end);
-        return calculateSegmentMetrics(path);
+    RideMetrics calculateIndividualRideMetrics(const string& start, const string& end, int band = 0) {
+        RideMetrics metrics = calculateRouteMetrics(findRoute(start, end));
+        metrics.price = fares.quote(metrics.distance, metrics.time, band);
+        return metrics;
     }
 
     // Calculate shared ride metrics for both users
     pair<RideMetrics, RideMetrics> calculateSharedRideMetrics(
         const string& user1Start, const string& user1End,
-        const string& user2Start, const string& user2End) {
+        const string& user2Start, const string& user2End, int band = 0) {
         
         RideMetrics user1Metrics = {0.0, 0.0, 0.0};
         RideMetrics user2Metrics = {0.0, 0.0, 0.0};
 
-        vector<string> user1InitialPath;
-        vector<string> sharedPath;
-        vector<string> user2FinalPath;
+        Route user1InitialRoute;
+        Route sharedRoute;
+        Route user2FinalRoute;
 
         // Calculate path segments
 
-        user1InitialPath = aStarShortestPath(user1Start, user2Start);
-        sharedPath = aStarShortestPath(user2Start, user1End);
-        user2FinalPath = aStarShortestPath(user1End, user2End);
+        user1InitialRoute = findRoute(user1Start, user2Start);
+        sharedRoute = findRoute(user2Start, user1End);
+        user2FinalRoute = findRoute(user1End, user2End);
 
         // Calculate metrics for each segment
-        RideMetrics initialSegment = calculateSegmentMetrics(user1InitialPath);
-        RideMetrics sharedSegment = calculateSegmentMetrics(sharedPath);
-        RideMetrics finalSegment = calculateSegmentMetrics(user2FinalPath);
+        RideMetrics initialSegment = calculateRouteMetrics(user1InitialRoute);
+        RideMetrics sharedSegment = calculateRouteMetrics(sharedRoute);
+        RideMetrics finalSegment = calculateRouteMetrics(user2FinalRoute);
 
         // Calculate User 1's metrics (initial solo + shared segment)
         user1Metrics.distance = initialSegment.distance + sharedSegment.distance;
         user1Metrics.time = initialSegment.time + sharedSegment.time;
-        user1Metrics.price = initialSegment.price + (sharedSegment.price / 2.0);
 
         // Calculate User 2's metrics (shared + final solo segment)
         user2Metrics.distance = sharedSegment.distance + finalSegment.distance;
         user2Metrics.time = sharedSegment.time + finalSegment.time;
-        user2Metrics.price = (sharedSegment.price / 2.0) + finalSegment.price;
+
+        // Price all three segments in one batch, two riders on the shared one.
+        // Each user's base fare rides on their solo segment so it is charged once.
+        FareEngine::FareBatch batch;
+        batch.add(initialSegment.distance, initialSegment.time, 1, user1Metrics.distance > 0.0 ? 1 : 0, band);
+        batch.add(sharedSegment.distance, sharedSegment.time, 2, 0, band);
+        batch.add(finalSegment.distance, finalSegment.time, 1, user2Metrics.distance > 0.0 ? 1 : 0, band);
+        fares.quoteBatch(batch);
+
+        user1Metrics.price = batch.fare[0] + batch.fare[1];
+        user2Metrics.price = batch.fare[1] + batch.fare[2];
 
         return {user1Metrics, user2Metrics};
     }
 };
-int main() {
-    string filePath = "cities.txt";
+class GraphPartitioner {
+public:
+    // Multilevel partition: coarsen by matching each city with its nearest
+    // unmatched neighbour, merge the coarsest groups down to the wanted number
+    // of regions, then project the cell ids back onto the original cities,
+    // moving boundary cities at each level to cut fewer roads and rebalance.
+    // Run offline: it needs the whole network, the shards it produces do not.
+    static unordered_map<string, int> partition(const Graph& graph, int regions) {
+        vector<string> names;
+        for (const auto& entry : graph.nodes) {
+            names.push_back(entry.first);
+        }
+        sort(names.begin(), names.end());
+
+        unordered_map<string, int> index;
+        for (size_t i = 0; i < names.size(); ++i) {
+            index[names[i]] = i;
+        }
+
+        vector<Level> levels(1);
+        levels[0].weight.assign(names.size(), 1.0);
+        levels[0].adj.resize(names.size());
+        levels[0].roads.resize(names.size());
+        for (const string& name : names) {
+            int v = index[name];
+            for (const auto& neighbor : graph.nodes.at(name)->neighbors) {
+                int u = index[neighbor.first->name];
+                if (u != v) {
+                    addLink(levels[0], v, u, neighbor.second, 1);
+                }
+            }
+        }
+
+        if (regions < 1) regions = 1;
+        double maxWeight = max(1.0, static_cast<double>(names.size()) / regions);
+        // Cells may end up slightly over an even share after refinement
+        double balanceLimit = max(1.0, ceil(maxWeight * 1.03));
+
+        // Coarsening phase; levelMaps[i] maps cities of levels[i] onto levels[i + 1]
+        vector<vector<int>> levelMaps;
+        while (levels.back().weight.size() > static_cast<size_t>(regions) * 2) {
+            const Level& current = levels.back();
+            size_t n = current.weight.size();
+            vector<int> match(n, -1);
+            int coarseCount = 0;
+
+            for (size_t v = 0; v < n; ++v) {
+                if (match[v] != -1) continue;
+                int best = -1;
+                double bestDistance = numeric_limits<double>::infinity();
+                for (const auto& link : current.adj[v]) {
+                    int u = link.first;
+                    if (match[u] != -1 || current.weight[v] + current.weight[u] > maxWeight) continue;
+                    if (link.second < bestDistance) {
+                        bestDistance = link.second;
+                        best = u;
+                    }
+                }
+                match[v] = coarseCount;
+                if (best != -1) match[best] = coarseCount;
+                coarseCount++;
+            }
+
+            // Stop once a level barely shrinks (e.g. the leaves of a star)
+            if (coarseCount > static_cast<int>(n) * 9 / 10) {
+                break;
+            }
+
+            Level coarse;
+            coarse.weight.assign(coarseCount, 0.0);
+            coarse.adj.resize(coarseCount);
+            coarse.roads.resize(coarseCount);
+            for (size_t v = 0; v < n; ++v) {
+                coarse.weight[match[v]] += current.weight[v];
+                for (const auto& link : current.adj[v]) {
+                    if (match[v] != match[link.first]) {
+                        addLink(coarse, match[v], match[link.first], link.second,
+                                current.roads[v].at(link.first));
+                    }
+                }
+            }
+            levelMaps.push_back(match);
+            levels.push_back(coarse);
+        }
+        const Level& current = levels.back();
+
+        // Initial partition: repeatedly merge the lightest group into its
+        // lightest neighbour, so a merge only goes over maxWeight when every
+        // neighbour is already heavy. Groups sit in a heap keyed by weight;
+        // entries left behind by a merge are skipped through the version counter.
+        size_t n = current.weight.size();
+        vector<int> parent(n);
+        vector<int> version(n, 0);
+        vector<double> groupWeight(current.weight);
+        vector<unordered_set<int>> groupAdj(n);
+        priority_queue<tuple<double, int, int>, vector<tuple<double, int, int>>, greater<>> lightest;
+        for (size_t v = 0; v < n; ++v) {
+            parent[v] = v;
+            for (const auto& link : current.adj[v]) {
+                groupAdj[v].insert(link.first);
+            }
+            lightest.push(make_tuple(groupWeight[v], static_cast<int>(v), 0));
+        }
+
+        size_t groupCount = n;
+        while (groupCount > static_cast<size_t>(regions) && !lightest.empty()) {
+            int group = get<1>(lightest.top());
+            int groupVersion = get<2>(lightest.top());
+            lightest.pop();
+            if (parent[group] != group || version[group] != groupVersion || groupAdj[group].empty()) {
+                continue;
+            }
+
+            int other = -1;
+            for (int neighbor : groupAdj[group]) {
+                if (other == -1 || groupWeight[neighbor] < groupWeight[other]) {
+                    other = neighbor;
+                }
+            }
+
+            // Fold the group with fewer neighbours into the other one
+            int keep = groupAdj[group].size() >= groupAdj[other].size() ? group : other;
+            int gone = keep == group ? other : group;
+            for (int neighbor : groupAdj[gone]) {
+                if (neighbor == keep) continue;
+                groupAdj[neighbor].erase(gone);
+                groupAdj[neighbor].insert(keep);
+                groupAdj[keep].insert(neighbor);
+            }
+            groupAdj[keep].erase(gone);
+            groupAdj[gone].clear();
+            parent[gone] = keep;
+            groupWeight[keep] += groupWeight[gone];
+            version[keep]++;
+            lightest.push(make_tuple(groupWeight[keep], keep, version[keep]));
+            groupCount--;
+        }
+
+        vector<int> group(n);
+        for (size_t v = 0; v < n; ++v) {
+            int root = v;
+            while (parent[root] != root) {
+                root = parent[root];
+            }
+            for (int step = v; parent[step] != root && step != root; ) {
+                int next = parent[step];
+                parent[step] = root;
+                step = next;
+            }
+            group[v] = root;
+        }
+
+        unordered_map<int, int> cellId;
+        vector<int> cells(n);
+        for (size_t v = 0; v < n; ++v) {
+            if (cellId.find(group[v]) == cellId.end()) {
+                int next = cellId.size();
+                cellId[group[v]] = next;
+            }
+            cells[v] = cellId[group[v]];
+        }
+
+        // Uncoarsening phase, refining the cells on every level
+        refine(levels.back(), cells, cellId.size(), balanceLimit);
+        for (size_t level = levelMaps.size(); level-- > 0; ) {
+            const vector<int>& match = levelMaps[level];
+            vector<int> finer(match.size());
+            for (size_t v = 0; v < match.size(); ++v) {
+                finer[v] = cells[match[v]];
+            }
+            cells = finer;
+            refine(levels[level], cells, cellId.size(), balanceLimit);
+        }
+
+        unordered_map<string, int> result;
+        for (size_t i = 0; i < names.size(); ++i) {
+            result[names[i]] = cells[i];
+        }
+        return result;
+    }
+
+private:
+    struct Level {
+        vector<double> weight;
+        vector<unordered_map<int, double>> adj;   // shortest road between two cities
+        vector<unordered_map<int, int>> roads;    // number of original roads between them
+    };
+
+    // Callers add every link from both ends, so road counts only go one way
+    static void addLink(Level& level, int a, int b, double distance, int roadCount) {
+        auto found = level.adj[a].find(b);
+        if (found == level.adj[a].end() || distance < found->second) {
+            level.adj[a][b] = distance;
+            level.adj[b][a] = distance;
+        }
+        level.roads[a][b] += roadCount;
+    }
+
+    // Boundary refinement: move a city to a neighbouring cell when that cuts
+    // fewer roads, evens out the cells without cutting more, or drains a cell
+    // over the balance limit. No move takes a cell over the limit or empties it.
+    static void refine(const Level& level, vector<int>& cells, size_t cellCount, double balanceLimit) {
+        size_t n = level.weight.size();
+        vector<double> cellWeight(cellCount, 0.0);
+        for (size_t v = 0; v < n; ++v) {
+            cellWeight[cells[v]] += level.weight[v];
+        }
+
+        for (int pass = 0; pass < 16; ++pass) {
+            int moved = 0;
+            for (size_t v = 0; v < n; ++v) {
+                int from = cells[v];
+                double weight = level.weight[v];
+                if (cellWeight[from] - weight <= 0.0) continue;
+
+                unordered_map<int, int> roadsTo;
+                for (const auto& link : level.roads[v]) {
+                    roadsTo[cells[link.first]] += link.second;
+                }
+                auto inside = roadsTo.find(from);
+                int internal = inside == roadsTo.end() ? 0 : inside->second;
+                if (roadsTo.empty() || (roadsTo.size() == 1 && internal > 0)) continue;
+
+                int best = -1;
+                int bestGain = numeric_limits<int>::min();
+                for (const auto& entry : roadsTo) {
+                    int to = entry.first;
+                    if (to == from || cellWeight[to] + weight > balanceLimit) continue;
+                    int gain = entry.second - internal;
+                    bool worthIt = gain > 0 ||
+                                   (gain == 0 && cellWeight[from] > cellWeight[to] + weight) ||
+                                   cellWeight[from] > balanceLimit;
+                    if (worthIt && gain > bestGain) {
+                        bestGain = gain;
+                        best = to;
+                    }
+                }
+
+                if (best != -1) {
+                    cells[v] = best;
+                    cellWeight[from] -= weight;
+                    cellWeight[best] += weight;
+                    moved++;
+                }
+            }
+            if (moved == 0) {
+                break;
+            }
+        }
+    }
+};
+
+// Serves the roads of a single region. Its shard file holds only that
+// region's cities, roads and boundary cities, so it loads without the rest
+// of the network.
+class ShardWorker {
+public:
+    struct BoundaryEdge {
+        string from;
+        string to;
+        double distance;
+    };
+
+    int cellId;
+
+    ShardWorker(int cellId) : cellId(cellId) {}
+
+    void addCity(const string& city) {
+        roads[city];
+    }
+
+    void addRoad(const string& city1, const string& city2, double distance) {
+        roads[city1].emplace_back(city2, distance);
+        roads[city2].emplace_back(city1, distance);
+    }
+
+    bool updateRoad(const string& city1, const string& city2, double distance) {
+        bool found = false;
+        for (auto& road : roads[city1]) {
+            if (road.first == city2) {
+                road.second = distance;
+                found = true;
+            }
+        }
+        for (auto& road : roads[city2]) {
+            if (road.first == city1) {
+                road.second = distance;
+            }
+        }
+        return found;
+    }
+
+    // Shard file lines: "road <city1> <city2> <distance>", "city <name>", "boundary <name>"
+    bool loadFromFile(const string& filePath) {
+        roads.clear();
+        boundary.clear();
+
+        ifstream file(filePath);
+        if (!file) {
+            cerr << "Error: Could not open shard file " << filePath << endl;
+            return false;
+        }
+
+        string line;
+        while (getline(file, line)) {
+            stringstream ss(line);
+            string kind, city1, city2;
+            double distance;
+            if (!(ss >> kind >> city1)) {
+                continue;
+            }
+            if (kind == "city") {
+                addCity(city1);
+            } else if (kind == "boundary") {
+                addCity(city1);
+                markBoundary(city1);
+            } else if (kind == "road" && ss >> city2 >> distance) {
+                addRoad(city1, city2, distance);
+            }
+        }
+        file.close();
+        return true;
+    }
+
+    bool saveToFile(const string& filePath) const {
+        ofstream file(filePath);
+        if (!file) {
+            cerr << "Error: Could not write shard file " << filePath << endl;
+            return false;
+        }
+
+        file << setprecision(numeric_limits<double>::max_digits10);
+        for (const auto& entry : roads) {
+            file << "city " << entry.first << endl;
+        }
+        for (const auto& entry : roads) {
+            for (const auto& road : entry.second) {
+                if (entry.first < road.first) {
+                    file << "road " << entry.first << " " << road.first << " " << road.second << endl;
+                }
+            }
+        }
+        for (const string& city : boundary) {
+            file << "boundary " << city << endl;
+        }
+        file.close();
+        return !file.fail();
+    }
+
+    void markBoundary(const string& city) {
+        if (find(boundary.begin(), boundary.end(), city) == boundary.end()) {
+            boundary.push_back(city);
+        }
+    }
+
+    const vector<string>& boundaryCities() const {
+        return boundary;
+    }
+
+    // Shortest distances inside this region from source to every boundary city
+    unordered_map<string, double> distancesToBoundary(const string& source) const {
+        unordered_map<string, double> dist = localDijkstra(source, nullptr);
+        unordered_map<string, double> result;
+        for (const string& city : boundary) {
+            if (dist.find(city) != dist.end()) {
+                result[city] = dist[city];
+            }
+        }
+        return result;
+    }
+
+    // Boundary-to-boundary clique used by the overlay graph
+    vector<BoundaryEdge> boundaryClique() const {
+        vector<BoundaryEdge> clique;
+        for (const string& from : boundary) {
+            unordered_map<string, double> dist = distancesToBoundary(from);
+            for (const string& to : boundary) {
+                if (to != from && dist.find(to) != dist.end()) {
+                    clique.push_back({from, to, dist[to]});
+                }
+            }
+        }
+        return clique;
+    }
+
+    double localDistance(const string& start, const string& end) const {
+        unordered_map<string, double> dist = localDijkstra(start, nullptr);
+        if (dist.find(end) == dist.end()) {
+            return numeric_limits<double>::infinity();
+        }
+        return dist[end];
+    }
+
+    vector<string> localPath(const string& start, const string& end) const {
+        unordered_map<string, string> cameFrom;
+        unordered_map<string, double> dist = localDijkstra(start, &cameFrom);
+        if (dist.find(end) == dist.end()) {
+            return {};
+        }
+
+        vector<string> path;
+        string current = end;
+        while (current != start) {
+            path.push_back(current);
+            current = cameFrom.at(current);
+        }
+        path.push_back(start);
+        reverse(path.begin(), path.end());
+        return path;
+    }
+
+    // One request line in, one reply line out; the same protocol serves the
+    // "--shard-worker" process and workers held in the coordinator's process.
+    // Requests: boundary, clique, distances <city>, local <a> <b>, path <a> <b>,
+    // update <a> <b> <distance>, save <file>. Replies start with "ok" or "error".
+    string handleRequest(const string& line) {
+        stringstream request(line);
+        ostringstream reply;
+        reply << setprecision(numeric_limits<double>::max_digits10) << "ok";
+
+        string kind, city1, city2;
+        double distance;
+        request >> kind;
+        if (kind == "boundary") {
+            for (const string& city : boundary) {
+                reply << " " << city;
+            }
+        } else if (kind == "clique") {
+            for (const auto& edge : boundaryClique()) {
+                reply << " " << edge.from << " " << edge.to << " " << edge.distance;
+            }
+        } else if (kind == "distances" && request >> city1) {
+            for (const auto& entry : distancesToBoundary(city1)) {
+                reply << " " << entry.first << " " << entry.second;
+            }
+        } else if (kind == "local" && request >> city1 >> city2) {
+            double local = localDistance(city1, city2);
+            reply << " " << (local == numeric_limits<double>::infinity() ? -1.0 : local);
+        } else if (kind == "path" && request >> city1 >> city2) {
+            for (const string& city : localPath(city1, city2)) {
+                reply << " " << city;
+            }
+        } else if (kind == "update" && request >> city1 >> city2 >> distance) {
+            reply << " " << (updateRoad(city1, city2, distance) ? 1 : 0);
+        } else if (kind == "save" && request >> city1) {
+            reply << " " << (saveToFile(city1) ? 1 : 0);
+        } else {
+            return "error unknown request: " + line;
+        }
+        return reply.str();
+    }
+
+private:
+    unordered_map<string, vector<pair<string, double>>> roads;
+    vector<string> boundary;
+
+    unordered_map<string, double> localDijkstra(const string& source,
+                                                unordered_map<string, string>* cameFrom) const {
+        unordered_map<string, double> dist;
+        if (roads.find(source) == roads.end()) {
+            return dist;
+        }
+
+        priority_queue<pair<double, string>, vector<pair<double, string>>, greater<>> openSet;
+        dist[source] = 0.0;
+        openSet.push({0.0, source});
+
+        while (!openSet.empty()) {
+            double currentDist = openSet.top().first;
+            string current = openSet.top().second;
+            openSet.pop();
+            if (currentDist > dist[current]) {
+                continue;
+            }
+
+            for (const auto& road : roads.at(current)) {
+                double tentativeDist = currentDist + road.second;
+                auto found = dist.find(road.first);
+                if (found == dist.end() || tentativeDist < found->second) {
+                    dist[road.first] = tentativeDist;
+                    if (cameFrom) (*cameFrom)[road.first] = current;
+                    openSet.push({tentativeDist, road.first});
+                }
+            }
+        }
+        return dist;
+    }
+};
+
+// Connection from the coordinator to one region's worker. On POSIX the worker
+// is a separate "--shard-worker <region file>" process and each request is
+// one line over a pair of pipes. Shards built in memory, and Windows builds,
+// keep the worker in this process and answer the same requests directly.
+class ShardClient {
+public:
+    explicit ShardClient(const ShardWorker& worker) : local(new ShardWorker(worker)) {}
+
+    ShardClient(const string& program, const string& regionFile) {
+#ifdef _WIN32
+        (void)program;
+        local.reset(new ShardWorker(-1));
+        if (!local->loadFromFile(regionFile)) {
+            local.reset();
+        }
+#else
+        int toChild[2], fromChild[2];
+        if (pipe(toChild) != 0) {
+            return;
+        }
+        if (pipe(fromChild) != 0) {
+            close(toChild[0]);
+            close(toChild[1]);
+            return;
+        }
+
+        // A worker that dies must not take the coordinator down on the next write
+        signal(SIGPIPE, SIG_IGN);
+        pid = fork();
+        if (pid == 0) {
+            dup2(toChild[0], STDIN_FILENO);
+            dup2(fromChild[1], STDOUT_FILENO);
+            close(toChild[0]);
+            close(toChild[1]);
+            close(fromChild[0]);
+            close(fromChild[1]);
+            execlp(program.c_str(), program.c_str(), "--shard-worker", regionFile.c_str(), (char*)nullptr);
+            _exit(127);
+        }
+
+        close(toChild[0]);
+        close(fromChild[1]);
+        if (pid < 0) {
+            close(toChild[1]);
+            close(fromChild[0]);
+            return;
+        }
+        fcntl(toChild[1], F_SETFD, FD_CLOEXEC);
+        fcntl(fromChild[0], F_SETFD, FD_CLOEXEC);
+        toWorker = fdopen(toChild[1], "w");
+        fromWorker = fdopen(fromChild[0], "r");
+#endif
+    }
+
+    ShardClient(const ShardClient&) = delete;
+    ShardClient& operator=(const ShardClient&) = delete;
+
+    ~ShardClient() {
+#ifndef _WIN32
+        if (toWorker) {
+            fprintf(toWorker, "quit\n");
+            fclose(toWorker);
+        }
+        if (fromWorker) {
+            fclose(fromWorker);
+        }
+        if (pid > 0) {
+            waitpid(pid, nullptr, 0);
+        }
+#endif
+    }
+
+    // Sends one request line and returns the worker's reply line
+    string request(const string& line) const {
+        if (local) {
+            return local->handleRequest(line);
+        }
+#ifndef _WIN32
+        if (toWorker && fromWorker) {
+            fprintf(toWorker, "%s\n", line.c_str());
+            fflush(toWorker);
+
+            char* buffer = nullptr;
+            size_t size = 0;
+            ssize_t length = ::getline(&buffer, &size, fromWorker);
+            string reply = length > 0 ? string(buffer, length) : "";
+            free(buffer);
+            if (!reply.empty() && reply.back() == '\n') {
+                reply.pop_back();
+            }
+            if (!reply.empty()) {
+                return reply;
+            }
+        }
+#endif
+        return "error worker unavailable";
+    }
+
+    bool isReady() const {
+        return request("boundary").compare(0, 2, "ok") == 0;
+    }
+
+    vector<string> boundaryCities() const {
+        stringstream reply(okReply("boundary"));
+        vector<string> cities;
+        string city;
+        while (reply >> city) {
+            cities.push_back(city);
+        }
+        return cities;
+    }
+
+    vector<ShardWorker::BoundaryEdge> boundaryClique() const {
+        stringstream reply(okReply("clique"));
+        vector<ShardWorker::BoundaryEdge> clique;
+        ShardWorker::BoundaryEdge edge;
+        while (reply >> edge.from >> edge.to >> edge.distance) {
+            clique.push_back(edge);
+        }
+        return clique;
+    }
+
+    unordered_map<string, double> distancesToBoundary(const string& source) const {
+        stringstream reply(okReply("distances " + source));
+        unordered_map<string, double> result;
+        string city;
+        double distance;
+        while (reply >> city >> distance) {
+            result[city] = distance;
+        }
+        return result;
+    }
+
+    double localDistance(const string& start, const string& end) const {
+        stringstream reply(okReply("local " + start + " " + end));
+        double distance;
+        if (!(reply >> distance) || distance < 0.0) {
+            return numeric_limits<double>::infinity();
+        }
+        return distance;
+    }
+
+    vector<string> localPath(const string& start, const string& end) const {
+        stringstream reply(okReply("path " + start + " " + end));
+        vector<string> path;
+        string city;
+        while (reply >> city) {
+            path.push_back(city);
+        }
+        return path;
+    }
+
+    bool updateRoad(const string& city1, const string& city2, double distance) const {
+        stringstream line;
+        line << setprecision(numeric_limits<double>::max_digits10)
+             << "update " << city1 << " " << city2 << " " << distance;
+        return okReply(line.str()) == "1";
+    }
+
+    bool saveToFile(const string& filePath) const {
+        return okReply("save " + filePath) == "1";
+    }
+
+private:
+    unique_ptr<ShardWorker> local;
+#ifndef _WIN32
+    pid_t pid = -1;
+    FILE* toWorker = nullptr;
+    FILE* fromWorker = nullptr;
+#endif
+
+    // Reply without its "ok" status, or empty when the request failed
+    string okReply(const string& line) const {
+        string reply = request(line);
+        if (reply.compare(0, 2, "ok") != 0) {
+            cerr << "Shard request failed: " << line << " (" << reply << ")" << endl;
+            return "";
+        }
+        return reply.size() > 3 ? reply.substr(3) : "";
+    }
+};
+
+// Local stand-in for the shard coordinator. It keeps only the city-to-region
+// lookup and the overlay graph (boundary cities, per-cell cliques and the
+// roads that cross regions); every question about the inside of a region
+// goes to that region's worker, which loadShards starts as its own process.
+class ShardCoordinator {
+public:
+    // Offline split: partition the full network and write one file per region
+    // plus "<prefix>_overlay.txt" with the region lookup and the roads between regions
+    static bool writeShards(const Graph& graph, int regions, const string& prefix) {
+        ShardCoordinator coordinator;
+        coordinator.build(graph, regions);
+        return coordinator.saveShards(prefix);
+    }
+
+    bool saveShards(const string& prefix) const {
+        for (size_t cell = 0; cell < workers.size(); ++cell) {
+            if (!workers[cell]->saveToFile(regionFile(prefix, cell))) {
+                cerr << "Error: Could not write shard file " << regionFile(prefix, cell) << endl;
+                return false;
+            }
+        }
+
+        ofstream file(prefix + "_overlay.txt");
+        if (!file) {
+            cerr << "Error: Could not write the overlay file." << endl;
+            return false;
+        }
+
+        file << setprecision(numeric_limits<double>::max_digits10);
+        for (const auto& entry : cellOf) {
+            file << "region " << entry.first << " " << entry.second << endl;
+        }
+        for (const auto& entry : overlay) {
+            for (const auto& arc : entry.second) {
+                if (arc.cell == -1 && entry.first < arc.to) {
+                    file << "link " << entry.first << " " << arc.to << " " << arc.distance << endl;
+                }
+            }
+        }
+        file.close();
+        return !file.fail();
+    }
+
+    // Starts one "<workerProgram> --shard-worker <region file>" process per
+    // region; with no worker program the regions are loaded in this process
+    bool loadShards(const string& prefix, const string& workerProgram = "") {
+        workers.clear();
+        overlay.clear();
+        cellOf.clear();
+
+        ifstream file(prefix + "_overlay.txt");
+        if (!file) {
+            cerr << "Error: Could not open the overlay file." << endl;
+            return false;
+        }
+
+        int cellCount = 0;
+        string line;
+        while (getline(file, line)) {
+            stringstream ss(line);
+            string kind, city1, city2;
+            int cell;
+            double distance;
+            if (!(ss >> kind >> city1)) {
+                continue;
+            }
+            if (kind == "region" && ss >> cell) {
+                cellOf[city1] = cell;
+                cellCount = max(cellCount, cell + 1);
+            } else if (kind == "link" && ss >> city2 >> distance) {
+                overlay[city1].push_back({city2, distance, -1});
+                overlay[city2].push_back({city1, distance, -1});
+            }
+        }
+        file.close();
+
+        for (int cell = 0; cell < cellCount; ++cell) {
+            if (workerProgram.empty()) {
+                ShardWorker worker(cell);
+                if (!worker.loadFromFile(regionFile(prefix, cell))) {
+                    return false;
+                }
+                workers.emplace_back(new ShardClient(worker));
+            } else {
+                workers.emplace_back(new ShardClient(workerProgram, regionFile(prefix, cell)));
+                if (!workers.back()->isReady()) {
+                    cerr << "Error: Shard worker for region " << cell << " did not start." << endl;
+                    return false;
+                }
+            }
+        }
+        finishBuild();
+        return true;
+    }
+
+    void build(const Graph& graph, int regions) {
+        workers.clear();
+        overlay.clear();
+        cellOf = GraphPartitioner::partition(graph, regions);
+
+        int cellCount = 0;
+        for (const auto& entry : cellOf) {
+            cellCount = max(cellCount, entry.second + 1);
+        }
+        vector<ShardWorker> regionWorkers;
+        for (int cell = 0; cell < cellCount; ++cell) {
+            regionWorkers.emplace_back(cell);
+        }
+
+        for (const auto& entry : graph.nodes) {
+            const string& city = entry.first;
+            int cell = cellOf[city];
+            regionWorkers[cell].addCity(city);
+
+            for (const auto& neighbor : entry.second->neighbors) {
+                const string& other = neighbor.first->name;
+                if (city >= other) {
+                    continue;
+                }
+                int otherCell = cellOf[other];
+                if (cell == otherCell) {
+                    regionWorkers[cell].addRoad(city, other, neighbor.second);
+                } else {
+                    regionWorkers[cell].markBoundary(city);
+                    regionWorkers[otherCell].markBoundary(other);
+                    overlay[city].push_back({other, neighbor.second, -1});
+                    overlay[other].push_back({city, neighbor.second, -1});
+                }
+            }
+        }
+
+        for (const ShardWorker& worker : regionWorkers) {
+            workers.emplace_back(new ShardClient(worker));
+        }
+        finishBuild();
+    }
+
+    int regionOf(const string& city) const {
+        auto found = cellOf.find(city);
+        return found == cellOf.end() ? -1 : found->second;
+    }
+
+    size_t regionCount() const {
+        return workers.size();
+    }
+
+    // Changing a road only recomputes the clique of the region that owns it
+    bool updateRoad(const string& city1, const string& city2, double distance) {
+        int cell1 = regionOf(city1);
+        int cell2 = regionOf(city2);
+        if (cell1 == -1 || cell2 == -1) {
+            return false;
+        }
+
+        if (cell1 == cell2) {
+            if (!workers[cell1]->updateRoad(city1, city2, distance)) {
+                return false;
+            }
+            rebuildCellOverlay(cell1);
+            return true;
+        }
+
+        bool found = false;
+        for (auto& arc : overlay[city1]) {
+            if (arc.to == city2 && arc.cell == -1) {
+                arc.distance = distance;
+                found = true;
+            }
+        }
+        for (auto& arc : overlay[city2]) {
+            if (arc.to == city1 && arc.cell == -1) {
+                arc.distance = distance;
+            }
+        }
+        return found;
+    }
+
+    // Route between any two cities; distance (if given) gets the route length
+    vector<string> shortestPath(const string& startNode, const string& endNode,
+                                double* distance = nullptr) const {
+        if (distance) *distance = 0.0;
+        int startCell = regionOf(startNode);
+        int endCell = regionOf(endNode);
+        if (startCell == -1 || endCell == -1) {
+            return {};
+        }
+        if (startNode == endNode) {
+            return {startNode};
+        }
+
+        const ShardClient& startWorker = *workers[startCell];
+        const ShardClient& endWorker = *workers[endCell];
+        unordered_map<string, double> toEnd = endWorker.distancesToBoundary(endNode);
+
+        double bestDistance = numeric_limits<double>::infinity();
+        string bestExit;
+        if (startCell == endCell) {
+            bestDistance = startWorker.localDistance(startNode, endNode);
+        }
+
+        // Dijkstra over the overlay, seeded with the start city's boundary distances
+        unordered_map<string, double> dist;
+        unordered_map<string, Hop> cameFrom;
+        priority_queue<pair<double, string>, vector<pair<double, string>>, greater<>> openSet;
+        for (const auto& entry : startWorker.distancesToBoundary(startNode)) {
+            dist[entry.first] = entry.second;
+            cameFrom[entry.first] = {startNode, startCell, true};
+            openSet.push({entry.second, entry.first});
+        }
+
+        while (!openSet.empty()) {
+            double currentDist = openSet.top().first;
+            string current = openSet.top().second;
+            openSet.pop();
+            if (currentDist >= bestDistance) {
+                break;
+            }
+            if (currentDist > dist[current]) {
+                continue;
+            }
+
+            auto exit = toEnd.find(current);
+            if (exit != toEnd.end() && currentDist + exit->second < bestDistance) {
+                bestDistance = currentDist + exit->second;
+                bestExit = current;
+            }
+
+            auto arcs = overlay.find(current);
+            if (arcs == overlay.end()) {
+                continue;
+            }
+            for (const auto& arc : arcs->second) {
+                double tentativeDist = currentDist + arc.distance;
+                auto found = dist.find(arc.to);
+                if (found == dist.end() || tentativeDist < found->second) {
+                    dist[arc.to] = tentativeDist;
+                    cameFrom[arc.to] = {current, arc.cell, false};
+                    openSet.push({tentativeDist, arc.to});
+                }
+            }
+        }
+
+        if (bestDistance == numeric_limits<double>::infinity()) {
+            return {};
+        }
+        if (distance) *distance = bestDistance;
+        if (bestExit.empty()) {
+            return startWorker.localPath(startNode, endNode);
+        }
+
+        // Unpack overlay hops back into city-level paths
+        vector<vector<string>> segments;
+        segments.push_back(endWorker.localPath(bestExit, endNode));
+        string current = bestExit;
+        while (true) {
+            const Hop& hop = cameFrom.at(current);
+            if (hop.cell == -1) {
+                segments.push_back({hop.from, current});
+            } else {
+                segments.push_back(workers[hop.cell]->localPath(hop.from, current));
+            }
+            if (hop.fromStart) {
+                break;
+            }
+            current = hop.from;
+        }
+
+        vector<string> path;
+        for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+            for (const string& city : *it) {
+                if (path.empty() || path.back() != city) {
+                    path.push_back(city);
+                }
+            }
+        }
+        return path;
+    }
+
+private:
+    struct OverlayArc {
+        string to;
+        double distance;
+        int cell;   // region whose worker unpacks this arc, -1 for a road between regions
+    };
+
+    struct Hop {
+        string from;
+        int cell;
+        bool fromStart;
+    };
+
+    unordered_map<string, int> cellOf;
+    vector<unique_ptr<ShardClient>> workers;
+    vector<vector<string>> boundaryOf;
+    unordered_map<string, vector<OverlayArc>> overlay;
+
+    static string regionFile(const string& prefix, int cell) {
+        return prefix + "_region" + to_string(cell) + ".txt";
+    }
+
+    void finishBuild() {
+        boundaryOf.clear();
+        for (size_t cell = 0; cell < workers.size(); ++cell) {
+            boundaryOf.push_back(workers[cell]->boundaryCities());
+            rebuildCellOverlay(cell);
+        }
+        cout << "Road network split into " << workers.size() << " regions." << endl;
+    }
+
+    void rebuildCellOverlay(int cell) {
+        for (const string& city : boundaryOf[cell]) {
+            auto& arcs = overlay[city];
+            arcs.erase(remove_if(arcs.begin(), arcs.end(),
+                                 [cell](const OverlayArc& arc) { return arc.cell == cell; }),
+                       arcs.end());
+        }
+        for (const auto& edge : workers[cell]->boundaryClique()) {
+            overlay[edge.from].push_back({edge.to, edge.distance, cell});
+        }
+    }
+};
+
+// Prices each batch row again as a one-row batch, which always takes the
+// scalar loop, and counts rows where the two disagree with the expected fare
+int compareFareRows(const FareEngine& engine, FareEngine::FareBatch& batch,
+                    const vector<double>& expected, int& checked) {
+    int failures = 0;
+    engine.quoteBatch(batch);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        FareEngine::FareBatch single;
+        single.add(batch.distance[i], batch.time[i], batch.riders[i], batch.boarding[i], batch.band[i]);
+        engine.quoteBatch(single);
+        checked++;
+        if (fabs(batch.fare[i] - expected[i]) > 1e-9 || fabs(single.fare[0] - expected[i]) > 1e-9) {
+            cout << "Fare mismatch in row " << i << ": expected " << expected[i] << ", batch "
+                 << batch.fare[i] << ", scalar " << single.fare[0] << endl;
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// Checks the batch fare kernel against the scalar loop and the default
+// rules against the old hard-coded prices (distance * 10, /2 when shared, 30% off)
+int runFareSelfTest(const string& filePath) {
+    int failures = 0;
+    int checked = 0;
+
+    // Odd length so the scalar tail runs, with riders 0/1/2, boarding 0/1 and out-of-range bands
+    const int bands[] = {0, 5, 23, -1, 24, 1000};
+    FareEngine::FareBatch batch;
+    for (int i = 0; i < 101; ++i) {
+        batch.add(i * 7.25, i * 7.25 / 50.0, i % 3, (i / 3) % 2, bands[i % 6]);
+    }
+
+    FareEngine defaults;
+    vector<double> expected;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        double price = batch.distance[i] * 10.0;
+        expected.push_back(batch.riders[i] == 2 ? price / 2.0 : price);
+    }
+    failures += compareFareRows(defaults, batch, expected, checked);
+
+    const string pricingFile = "fare_selftest_pricing.txt";
+    ofstream rules(pricingFile);
+    rules << "base 50\nper_km 12\nper_min 1.5\nsurge 5 2\nsurge 23 1.25\n";
+    rules.close();
+    FareEngine custom;
+    custom.loadRulesFromFile(pricingFile);
+    remove(pricingFile.c_str());
+
+    expected.clear();
+    for (size_t i = 0; i < batch.size(); ++i) {
+        double surge = batch.band[i] == 5 ? 2.0 : (batch.band[i] == 23 ? 1.25 : 1.0);
+        double riders = batch.riders[i] > 1 ? batch.riders[i] : 1;
+        expected.push_back(batch.boarding[i] * 50.0 * surge +
+                           (12.0 * batch.distance[i] + 90.0 * batch.time[i]) * surge / riders);
+    }
+    failures += compareFareRows(custom, batch, expected, checked);
+
+    // Ride prices from the graph against the old formulas
     Graph graph;
     graph.loadGraphFromFile(filePath);
+    for (const auto& start : graph.nodes) {
+        for (const auto& end : graph.nodes) {
+            const string& a = start.first;
+            const string& b = end.first;
+            double solo = graph.calculateSegmentMetrics(graph.aStarShortestPath(a, b)).distance * 10.0;
+            Graph::RideMetrics individual = graph.calculateIndividualRideMetrics(a, b);
+
+            // Second rider joins at the first rider's destination's neighbour city
+            const string& c = graph.nodes.at(b)->neighbors.front().first->name;
+            const string& d = graph.nodes.at(a)->neighbors.front().first->name;
+            auto shared = graph.calculateSharedRideMetrics(a, b, c, d);
+            double initial = graph.calculateSegmentMetrics(graph.aStarShortestPath(a, c)).distance * 10.0;
+            double common = graph.calculateSegmentMetrics(graph.aStarShortestPath(c, b)).distance * 10.0;
+            double last = graph.calculateSegmentMetrics(graph.aStarShortestPath(b, d)).distance * 10.0;
+            double user1 = initial + common / 2.0;
+            double user2 = common / 2.0 + last;
+
+            checked++;
+            if (fabs(individual.price - solo) > 1e-9 || fabs(shared.first.price - user1) > 1e-9 ||
+                fabs(shared.second.price - user2) > 1e-9 ||
+                fabs(graph.fares.applyShareDiscount(shared.first.price) - (user1 - user1 * 0.3)) > 1e-9) {
+                cout << "Ride price mismatch for " << a << " -> " << b << endl;
+                failures++;
+            }
+        }
+    }
+
+    if (failures == 0) {
+        cout << "Fare self-test passed (" << checked << " quotes checked)." << endl;
+        return 0;
+    }
+    cout << "Fare self-test failed: " << failures << " of " << checked << " quotes differ." << endl;
+    return 1;
+}
+
+// Distance of a route over the shortest road for each hop, 0 for an empty or
+// single-city route and infinity when two consecutive cities share no road
+double routeDistance(const Graph& graph, const vector<string>& path) {
+    double total = 0.0;
+    for (size_t i = 0; i + 1 < path.size(); ++i) {
+        double hop = numeric_limits<double>::infinity();
+        for (const auto& neighbor : graph.nodes.at(path[i])->neighbors) {
+            if (neighbor.first->name == path[i + 1]) {
+                hop = min(hop, neighbor.second);
+            }
+        }
+        total += hop;
+    }
+    return total;
+}
+
+// Compares regional routing against aStarShortestPath on every city pair
+int compareShardRoutes(const Graph& graph, const ShardCoordinator& coordinator, int& checked) {
+    int failures = 0;
+    for (const auto& start : graph.nodes) {
+        for (const auto& end : graph.nodes) {
+            vector<string> expected = graph.aStarShortestPath(start.first, end.first);
+            vector<string> actual = coordinator.shortestPath(start.first, end.first);
+            checked++;
+
+            bool sameEnds = expected.empty() == actual.empty() &&
+                            (actual.empty() || (actual.front() == start.first && actual.back() == end.first));
+            double actualDistance = routeDistance(graph, actual);
+            if (!sameEnds || actualDistance == numeric_limits<double>::infinity() ||
+                fabs(routeDistance(graph, expected) - actualDistance) > 1e-9) {
+                cout << "Mismatch for " << start.first << " -> " << end.first << ": expected "
+                     << routeDistance(graph, expected) << ", got " << routeDistance(graph, actual) << endl;
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+void setRoadDistance(Graph& graph, const string& city1, const string& city2, double distance) {
+    for (auto& neighbor : graph.nodes.at(city1)->neighbors) {
+        if (neighbor.first->name == city2) neighbor.second = distance;
+    }
+    for (auto& neighbor : graph.nodes.at(city2)->neighbors) {
+        if (neighbor.first->name == city1) neighbor.second = distance;
+    }
+}
+
+void removeShardFiles(const string& prefix, size_t regionCount) {
+    remove((prefix + "_overlay.txt").c_str());
+    for (size_t cell = 0; cell < regionCount; ++cell) {
+        remove((prefix + "_region" + to_string(cell) + ".txt").c_str());
+    }
+}
+
+// Ride prices routed through the shard coordinator against the local graph
+int compareShardRides(Graph& graph, const ShardCoordinator& coordinator, int& checked) {
+    Graph sharded;
+    sharded.routeFinder = [&coordinator](const string& start, const string& end) {
+        double distance = 0.0;
+        vector<string> path = coordinator.shortestPath(start, end, &distance);
+        return Graph::Route{path, distance};
+    };
+
+    int failures = 0;
+    for (const auto& start : graph.nodes) {
+        for (const auto& end : graph.nodes) {
+            const string& other = end.second->neighbors.front().first->name;
+            auto expected = graph.calculateSharedRideMetrics(start.first, end.first, other, start.first);
+            auto actual = sharded.calculateSharedRideMetrics(start.first, end.first, other, start.first);
+            checked++;
+            if (fabs(expected.first.price - actual.first.price) > 1e-9 ||
+                fabs(expected.second.price - actual.second.price) > 1e-9 ||
+                fabs(expected.second.distance - actual.second.distance) > 1e-9) {
+                cout << "Ride mismatch for " << start.first << " -> " << end.first << endl;
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+// Checks the shard coordinator built in memory and served by worker processes
+// started from the saved shard files, before and after a road update, for
+// several region counts
+int runShardSelfTest(const string& filePath, const string& program) {
+    int failures = 0;
+    int checked = 0;
+    const string prefix = "shard_selftest";
+
+    for (int regions : {1, 2, 3, 4, 6}) {
+        Graph graph;
+        graph.loadGraphFromFile(filePath);
+        if (graph.nodes.empty()) {
+            return 1;
+        }
+
+        ShardCoordinator built;
+        built.build(graph, regions);
+        ShardCoordinator loaded;
+        if (!built.saveShards(prefix) || !loaded.loadShards(prefix, program)) {
+            removeShardFiles(prefix, built.regionCount());
+            return 1;
+        }
+        failures += compareShardRoutes(graph, built, checked);
+        failures += compareShardRoutes(graph, loaded, checked);
+        failures += compareShardRides(graph, loaded, checked);
+
+        // Halve every road out of one city, covering roads inside and between regions
+        const Node* city = graph.nodes.begin()->second;
+        vector<pair<string, double>> roads;
+        for (const auto& neighbor : city->neighbors) {
+            roads.emplace_back(neighbor.first->name, neighbor.second / 2.0);
+        }
+        for (const auto& road : roads) {
+            setRoadDistance(graph, city->name, road.first, road.second);
+            built.updateRoad(city->name, road.first, road.second);
+            loaded.updateRoad(city->name, road.first, road.second);
+        }
+        failures += compareShardRoutes(graph, built, checked);
+        failures += compareShardRoutes(graph, loaded, checked);
+
+        removeShardFiles(prefix, built.regionCount());
+    }
+
+    if (failures == 0) {
+        cout << "Shard self-test passed (" << checked << " routes checked)." << endl;
+        return 0;
+    }
+    cout << "Shard self-test failed: " << failures << " of " << checked << " routes differ." << endl;
+    return 1;
+}
+
+// Serves one region file over stdin/stdout for a coordinator, one request per line
+int runShardWorker(const string& regionFile) {
+    ShardWorker worker(-1);
+    if (!worker.loadFromFile(regionFile)) {
+        return 1;
+    }
+
+    string line;
+    while (getline(cin, line)) {
+        if (line == "quit") {
+            break;
+        }
+        cout << worker.handleRequest(line) << endl;
+    }
+    return 0;
+}
+
+int printUsage(const string& program) {
+    cerr << "Usage: " << program << "                          (interactive ride sharing on cities.txt)" << endl;
+    cerr << "       " << program << " --shards <prefix>        (same, routed through shard worker processes)" << endl;
+    cerr << "       " << program << " --shard-split <regions>  (write cities_region<N>.txt and cities_overlay.txt)" << endl;
+    cerr << "       " << program << " --shard-worker <file>    (serve one region file, started by the coordinator)" << endl;
+    cerr << "       " << program << " --shard-selftest" << endl;
+    cerr << "       " << program << " --fare-selftest" << endl;
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+    string filePath = "cities.txt";
+    string program = argv[0];
+    string mode = argc > 1 ? argv[1] : "";
+    string argument = argc > 2 ? argv[2] : "";
+    bool needsArgument = mode == "--shards" || mode == "--shard-split" || mode == "--shard-worker";
+    if ((needsArgument && argc != 3) || (!needsArgument && argc > 2)) {
+        return printUsage(program);
+    }
+
+    if (mode == "--shard-worker") {
+        return runShardWorker(argument);
+    }
+    if (mode == "--shard-selftest") {
+        return runShardSelfTest(filePath, program);
+    }
+    if (mode == "--fare-selftest") {
+        return runFareSelfTest(filePath);
+    }
+    if (mode == "--shard-split") {
+        int regions = 0;
+        stringstream count(argument);
+        if (!(count >> regions) || !count.eof() || regions < 1) {
+            cerr << "Error: region count must be a positive whole number, got '" << argument << "'." << endl;
+            return printUsage(program);
+        }
+        Graph graph;
+        graph.loadGraphFromFile(filePath);
+        return ShardCoordinator::writeShards(graph, regions, "cities") ? 0 : 1;
+    }
+    if (!mode.empty() && mode != "--shards") {
+        cerr << "Error: unknown option '" << mode << "'." << endl;
+        return printUsage(program);
+    }
+
+    // With --shards the full network is never loaded here: routes come from
+    // the coordinator, which holds only the overlay and asks the region workers
+    Graph graph;
+    ShardCoordinator shards;
+    if (mode == "--shards") {
+        if (!shards.loadShards(argument, program)) {
+            return 1;
+        }
+        graph.routeFinder = [&shards](const string& start, const string& end) {
+            double distance = 0.0;
+            vector<string> path = shards.shortestPath(start, end, &distance);
+            return Graph::Route{path, distance};
+        };
+    } else {
+        graph.loadGraphFromFile(filePath);
+    }
+    graph.fares.loadRulesFromFile("pricing.txt");
 
     string user1Origin, user1Dest, user2Origin, user2Dest;
 
@@ -254,13 +1775,17 @@ int main() {
     cout << "Enter User 2 Destination: ";
     cin >> user2Dest;
 
+    // Surge pricing follows the current hour of day
+    time_t now = time(nullptr);
+    int band = localtime(&now)->tm_hour;
+
     // Calculate individual ride metrics
-    auto user1Individual = graph.calculateIndividualRideMetrics(user1Origin, user1Dest);
-    auto user2Individual = graph.calculateIndividualRideMetrics(user2Origin, user2Dest);
+    auto user1Individual = graph.calculateIndividualRideMetrics(user1Origin, user1Dest, band);
+    auto user2Individual = graph.calculateIndividualRideMetrics(user2Origin, user2Dest, band);
 
     // Calculate shared ride metrics
     pair<Graph::RideMetrics, Graph::RideMetrics> sharedMetrics = graph.calculateSharedRideMetrics(
-        user1Origin, user1Dest, user2Origin, user2Dest);
+        user1Origin, user1Dest, user2Origin, user2Dest, band);
 
     // Manually unpack the pair into individual variables
     Graph::RideMetrics user1Shared = sharedMetrics.first;
@@ -271,23 +1796,23 @@ int main() {
 
     // Individual paths
     cout << "\nUser 1 Solo Path: ";
-    vector<string> user1Path = graph.aStarShortestPath(user1Origin, user1Dest);
+    vector<string> user1Path = graph.findRoute(user1Origin, user1Dest).path;
     for (const auto& city : user1Path) {
         cout << city << " -> ";
     }
     cout << "END" << endl;
 
     cout << "User 2 Solo Path: ";
-    vector<string> user2Path = graph.aStarShortestPath(user2Origin, user2Dest);
+    vector<string> user2Path = graph.findRoute(user2Origin, user2Dest).path;
     for (const auto& city : user2Path) {
         cout << city << " -> ";
     }
     cout << "END" << endl;
 
     // Shared paths
-    vector<string> initialPath = graph.aStarShortestPath(user1Origin, user2Origin);
-    vector<string> sharedPath = graph.aStarShortestPath(user2Origin, user1Dest);
-    vector<string> finalPath = graph.aStarShortestPath(user1Dest, user2Dest);
+    vector<string> initialPath = graph.findRoute(user1Origin, user2Origin).path;
+    vector<string> sharedPath = graph.findRoute(user2Origin, user1Dest).path;
+    vector<string> finalPath = graph.findRoute(user1Dest, user2Dest).path;
 
     cout << "\nUser 1 solo: ";
     for (const auto& city : initialPath) {
@@ -324,8 +1849,8 @@ int main() {
     cout << "------------------------------------------------------------------" << endl;
 
     // Prompt user for decision
-    cout << "The final price for User 1: " << user1Shared.price - user1Shared.price * 0.3 << " units" << endl;
-    cout << "The final price for User 2: " << user2Shared.price - user2Shared.price * 0.3 << " units" << endl;
+    cout << "The final price for User 1: " << graph.fares.applyShareDiscount(user1Shared.price) << " units" << endl;
+    cout << "The final price for User 2: " << graph.fares.applyShareDiscount(user2Shared.price) << " units" << endl;
     cout << "\nDo you want to share a ride? (yes/no): "<<endl;
     string decision;
     cin >> decision;
@@ -337,8 +1862,8 @@ int main() {
         cout << "\nFinal prices:" << endl;
         cout <<endl;
         cout <<"If you decide to share a ride" << endl;
-        cout << "User 1 Discounted Price: " << user1Shared.price - user1Shared.price * 0.3 << " units" << endl;
-        cout << "User 2 Discounted Price " << user2Shared.price - user2Shared.price * 0.3 << " units" << endl;
+        cout << "User 1 Discounted Price: " << graph.fares.applyShareDiscount(user1Shared.price) << " units" << endl;
+        cout << "User 2 Discounted Price " << graph.fares.applyShareDiscount(user2Shared.price) << " units" << endl;
     } else {
         cout << "\nIndividual ride prices will be:" << endl;
         cout << "User 1: " << user1Individual.price << " units" << endl;